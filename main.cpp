@@ -6,6 +6,16 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <charconv>
+#include <string_view>
+#include <tuple>
+#include <filesystem>
 using namespace std;
 
 vector<string> ReadFileLines(const string &path) {
@@ -27,19 +37,33 @@ vector<string> ReadFileLines(const string &path) {
     return lines;
 }
 
-void WriteFileLines(const string &path, const vector<string> &lines, bool append = true) {
+// Rewrites (append = false) go to a temporary file that is renamed over the
+// old one, so a failed write never leaves a half-written file behind
+bool WriteFileLines(const string &path, const vector<string> &lines, bool append = true) {
+    string target = append ? path : path + ".tmp";
     auto mode = append ? ios::app : ios::trunc;
-    fstream file(path.c_str(), ios::in | ios::out | mode);
+    fstream file(target.c_str(), ios::in | ios::out | mode);
     
     if (file.fail()) {
-        cout << "\nERROR: Can't open the file: " << path << "\n";
-        return;
+        cout << "\nERROR: Can't open the file: " << target << "\n";
+        return false;
     }
     
     for (const auto &line : lines)
         file << line << "\n";
     
     file.close();
+    
+    // filesystem::rename replaces an existing target on every platform
+    error_code error;
+    if (!append && !file.fail())
+        filesystem::rename(target, path, error);
+    
+    if (file.fail() || error) {
+        cout << "\nERROR: Can't write the file: " << path << "\n";
+        return false;
+    }
+    return true;
 }
 
 vector<string> SplitString(const string &str, const string &delimiter = ",") {
@@ -82,6 +106,743 @@ int ShowMenu(const vector<string> &choices) {
     return ReadInt(1, choices.size());
 }
 
+// Block-compressed storage: records are grouped into blocks of
+// BLOCK_RECORDS lines and each block is compressed on its own, so a single
+// record can be read back by inflating just the block that holds it.
+
+const int LZ_MIN_MATCH = 4;
+const int LZ_MAX_OFFSET = 65535;
+const int LZ_HASH_BITS = 14;
+
+uint32_t LzHash(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+void LzWriteLength(string &out, size_t length) {
+    while (length >= 255) {
+        out.push_back((char)255);
+        length -= 255;
+    }
+    out.push_back((char)length);
+}
+
+bool LzReadLength(const string &in, size_t &pos, size_t &length) {
+    while (pos < in.size()) {
+        unsigned char byte = in[pos++];
+        length += byte;
+        if (byte != 255)
+            return true;
+    }
+    return false;
+}
+
+// Sequence layout (LZ4 style): token byte with the literal count in the high
+// nibble and (match length - 4) in the low nibble, extra length bytes when a
+// nibble is 15, the literals, then a 2-byte offset. The last sequence has
+// literals only.
+void LzWriteSequence(string &out, const string &window, size_t literal_start,
+                     size_t literals, size_t offset, size_t match_length) {
+    size_t match_code = match_length - LZ_MIN_MATCH;
+    out.push_back((char)((min(literals, (size_t)15) << 4) | min(match_code, (size_t)15)));
+    
+    if (literals >= 15)
+        LzWriteLength(out, literals - 15);
+    out.append(window, literal_start, literals);
+    
+    out.push_back((char)(offset & 0xFF));
+    out.push_back((char)(offset >> 8));
+    
+    if (match_code >= 15)
+        LzWriteLength(out, match_code - 15);
+}
+
+// Matches may point back into the dictionary, which is shared by all blocks
+// of a file, so even small blocks find repeated text.
+string LzCompress(const string &input, const string &dictionary) {
+    string window = dictionary + input;
+    size_t start = dictionary.size(), end = window.size();
+    vector<int> table(1 << LZ_HASH_BITS, -1);
+    
+    for (size_t i = 0; i + LZ_MIN_MATCH <= start; ++i)
+        table[LzHash(&window[i])] = i;
+    
+    string out;
+    size_t anchor = start, pos = start;
+    
+    while (pos + LZ_MIN_MATCH <= end) {
+        uint32_t hash = LzHash(&window[pos]);
+        int candidate = table[hash];
+        table[hash] = pos;
+        
+        if (candidate < 0 || pos - candidate > LZ_MAX_OFFSET ||
+            memcmp(&window[candidate], &window[pos], LZ_MIN_MATCH) != 0) {
+            ++pos;
+            continue;
+        }
+        
+        size_t length = LZ_MIN_MATCH;
+        while (pos + length < end && window[candidate + length] == window[pos + length])
+            ++length;
+        
+        LzWriteSequence(out, window, anchor, pos - anchor, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+    
+    size_t literals = end - anchor;
+    out.push_back((char)(min(literals, (size_t)15) << 4));
+    if (literals >= 15)
+        LzWriteLength(out, literals - 15);
+    out.append(window, anchor, literals);
+    
+    return out;
+}
+
+// Fails as soon as the output would grow past raw_size
+bool LzDecompress(const string &input, const string &dictionary, size_t raw_size, string &output) {
+    const size_t limit = dictionary.size() + raw_size;
+    string window;
+    window.reserve(limit);
+    window = dictionary;
+    size_t pos = 0;
+    
+    while (pos < input.size()) {
+        unsigned char token = input[pos++];
+        
+        size_t literals = token >> 4;
+        if (literals == 15 && !LzReadLength(input, pos, literals))
+            return false;
+        if (pos + literals > input.size() || window.size() + literals > limit)
+            return false;
+        window.append(input, pos, literals);
+        pos += literals;
+        
+        if (pos == input.size())
+            break;
+        if (pos + 2 > input.size())
+            return false;
+        
+        size_t offset = (unsigned char)input[pos] | ((unsigned char)input[pos + 1] << 8);
+        pos += 2;
+        
+        size_t length = token & 0x0F;
+        if (length == 15 && !LzReadLength(input, pos, length))
+            return false;
+        length += LZ_MIN_MATCH;
+        
+        if (offset == 0 || offset > window.size() || window.size() + length > limit)
+            return false;
+        
+        size_t from = window.size() - offset;
+        for (size_t i = 0; i < length; ++i)  // byte by byte: matches may overlap
+            window.push_back(window[from + i]);
+    }
+    
+    if (window.size() - dictionary.size() != raw_size)
+        return false;
+    
+    output.assign(window, dictionary.size(), string::npos);
+    return true;
+}
+
+// Builds the shared dictionary from the fragments that repeat most often
+// across records (user ids, common words, question phrasing).
+string TrainDictionary(const vector<string> &samples, size_t max_size = 4096) {
+    const size_t fragment_size = 8;
+    const size_t max_samples = 4096;
+    unordered_map<string, int> counts;
+    
+    for (size_t s = 0; s < samples.size() && s < max_samples; ++s) {
+        const string &sample = samples[s];
+        for (size_t i = 0; i + fragment_size <= sample.size(); ++i)
+            ++counts[sample.substr(i, fragment_size)];
+    }
+    
+    vector<pair<int, string>> ranked;
+    for (const auto &pair : counts) {
+        if (pair.second > 1)
+            ranked.push_back({pair.second, pair.first});
+    }
+    sort(ranked.begin(), ranked.end(), greater<pair<int, string>>());
+    
+    string dictionary;
+    for (const auto &fragment : ranked) {
+        if (dictionary.size() + fragment_size > max_size)
+            break;
+        if (dictionary.find(fragment.second) == string::npos)
+            dictionary += fragment.second;
+    }
+    
+    return dictionary;
+}
+
+void WriteUint32(string &out, uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+        out.push_back((char)((value >> (8 * i)) & 0xFF));
+}
+
+uint32_t ReadUint32(const char *p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= (uint32_t)(unsigned char)p[i] << (8 * i);
+    return value;
+}
+
+// FNV-1a over 8-byte words, stored per block to catch damage the codec
+// itself can't notice
+uint32_t Checksum(const string &data) {
+    const uint64_t prime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull;
+    size_t pos = 0;
+    
+    for (; pos + 8 <= data.size(); pos += 8) {
+        uint64_t word;
+        memcpy(&word, data.data() + pos, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; pos < data.size(); ++pos)
+        hash = (hash ^ (unsigned char)data[pos]) * prime;
+    
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// File layout (integers are little-endian uint32):
+//   "ASKB", version, dictionary size, dictionary bytes, block count,
+//   block index entries, then the compressed blocks back to back.
+// Records are keyed by their first field and must be written in key order.
+class BlockStore {
+private:
+    struct BlockIndex {
+        int first_id;
+        int last_id;
+        uint32_t record_count;
+        uint32_t offset;           // from the start of the block data
+        uint32_t compressed_size;
+        uint32_t raw_size;
+        uint32_t checksum;         // of the raw block
+    };
+    
+    static const size_t INDEX_ENTRY_SIZE = 28;
+    static const size_t HEADER_SIZE = 12;
+    // One compressed byte never expands to more than this many raw bytes
+    static const uint64_t MAX_EXPANSION = 256;
+    
+    static const int BLOCK_RECORDS = 64;
+    static const uint32_t FORMAT_VERSION = 1;
+    
+    ifstream file;
+    string dictionary;
+    vector<BlockIndex> blocks;
+    streamoff data_start;
+    
+    static int RecordId(const string &line) {
+        return ToInt(line.substr(0, line.find(',')));
+    }
+    
+    bool ReadBytes(string &out, size_t size) {
+        out.resize(size);
+        return size == 0 || file.read(&out[0], size).good();
+    }
+    
+    bool ReadBlock(const BlockIndex &block, string &raw) {
+        string compressed;
+        file.clear();
+        file.seekg(data_start + (streamoff)block.offset);
+        if (!ReadBytes(compressed, block.compressed_size))
+            return false;
+        return LzDecompress(compressed, dictionary, block.raw_size, raw) &&
+               Checksum(raw) == block.checksum;
+    }
+    
+public:
+    BlockStore() : data_start(0) {}
+    
+    static bool Write(const string &path, const vector<string> &lines) {
+        string dict = TrainDictionary(lines);
+        string index, data;
+        uint32_t block_count = 0;
+        
+        for (size_t first = 0; first < lines.size(); first += BLOCK_RECORDS) {
+            size_t last = min(first + BLOCK_RECORDS, lines.size()) - 1;
+            string raw;
+            for (size_t i = first; i <= last; ++i)
+                raw += lines[i] + "\n";
+            
+            string compressed = LzCompress(raw, dict);
+            WriteUint32(index, RecordId(lines[first]));
+            WriteUint32(index, RecordId(lines[last]));
+            WriteUint32(index, last - first + 1);
+            WriteUint32(index, data.size());
+            WriteUint32(index, compressed.size());
+            WriteUint32(index, raw.size());
+            WriteUint32(index, Checksum(raw));
+            data += compressed;
+            ++block_count;
+        }
+        
+        string header = "ASKB";
+        WriteUint32(header, FORMAT_VERSION);
+        WriteUint32(header, dict.size());
+        header += dict;
+        WriteUint32(header, block_count);
+        
+        // Write to a temporary file and rename it so readers never see a half-written store
+        string temp_path = path + ".tmp";
+        ofstream out(temp_path.c_str(), ios::binary | ios::trunc);
+        if (out.fail()) {
+            cout << "\nERROR: Can't open the file: " << temp_path << "\n";
+            return false;
+        }
+        
+        out << header << index << data;
+        out.close();
+        
+        // filesystem::rename replaces an existing target on every platform
+        error_code error;
+        if (!out.fail())
+            filesystem::rename(temp_path, path, error);
+        
+        if (out.fail() || error) {
+            cout << "\nERROR: Can't write the file: " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+    
+    // Returns false if the file can't be read or is corrupt
+    // Every size read from the file is checked against the file length
+    // before anything is allocated for it
+    bool Open(const string &path) {
+        blocks.clear();
+        dictionary.clear();
+        file.close();
+        file.clear();
+        file.open(path.c_str(), ios::binary | ios::ate);
+        if (file.fail()) {
+            cout << "\nERROR: Can't open the file: " << path << "\n";
+            return false;
+        }
+        
+        uint64_t file_size = file.tellg();
+        file.seekg(0);
+        
+        string header, count, index;
+        if (file_size < HEADER_SIZE || !ReadBytes(header, HEADER_SIZE) ||
+            header.compare(0, 4, "ASKB") != 0 || ReadUint32(&header[4]) != FORMAT_VERSION) {
+            cout << "\nERROR: Invalid block store: " << path << "\n";
+            return false;
+        }
+        
+        uint64_t dictionary_size = ReadUint32(&header[8]);
+        if (HEADER_SIZE + dictionary_size + 4 > file_size ||
+            !ReadBytes(dictionary, dictionary_size) || !ReadBytes(count, 4)) {
+            cout << "\nERROR: Invalid block store: " << path << "\n";
+            return false;
+        }
+        
+        uint64_t index_size = (uint64_t)ReadUint32(&count[0]) * INDEX_ENTRY_SIZE;
+        data_start = HEADER_SIZE + dictionary_size + 4 + index_size;
+        if ((uint64_t)data_start > file_size || !ReadBytes(index, index_size)) {
+            cout << "\nERROR: Invalid block store: " << path << "\n";
+            return false;
+        }
+        
+        uint64_t data_size = file_size - data_start;
+        for (size_t pos = 0; pos < index.size(); pos += INDEX_ENTRY_SIZE) {
+            const char *p = &index[pos];
+            BlockIndex block = {(int)ReadUint32(p), (int)ReadUint32(p + 4), ReadUint32(p + 8),
+                                ReadUint32(p + 12), ReadUint32(p + 16), ReadUint32(p + 20),
+                                ReadUint32(p + 24)};
+            
+            if ((uint64_t)block.offset + block.compressed_size > data_size ||
+                block.raw_size > (uint64_t)block.compressed_size * MAX_EXPANSION) {
+                cout << "\nERROR: Invalid block store: " << path << "\n";
+                blocks.clear();
+                return false;
+            }
+            blocks.push_back(block);
+        }
+        
+        return true;
+    }
+    
+    // Fails as a whole on the first corrupt block, never returns part of the store
+    bool ReadAll(vector<string> &lines) {
+        lines.clear();
+        string raw;
+        
+        for (const auto &block : blocks) {
+            if (!ReadBlock(block, raw)) {
+                cout << "\nERROR: Corrupt block in block store\n";
+                lines.clear();
+                return false;
+            }
+            
+            size_t start = 0, end;
+            while ((end = raw.find('\n', start)) != string::npos) {
+                lines.push_back(raw.substr(start, end - start));
+                start = end + 1;
+            }
+        }
+        
+        return true;
+    }
+    
+    // Decodes only the block whose id range holds the record
+    bool ReadRecord(int id, string &line) {
+        auto it = lower_bound(blocks.begin(), blocks.end(), id,
+            [](const BlockIndex &block, int key) { return block.last_id < key; });
+        if (it == blocks.end() || it->first_id > id)
+            return false;
+        
+        string raw;
+        if (!ReadBlock(*it, raw))
+            return false;
+        
+        size_t start = 0, end;
+        while ((end = raw.find('\n', start)) != string::npos) {
+            if (RecordId(raw.substr(start, end - start)) == id) {
+                line = raw.substr(start, end - start);
+                return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+    
+    uint32_t GetRecordCount() const {
+        uint32_t total = 0;
+        for (const auto &block : blocks)
+            total += block.record_count;
+        return total;
+    }
+};
+
+enum class OutputFormat { TEXT, JSON_LINES };
+
+void AppendInt(string &out, int value) {
+    char digits[16];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void AppendJsonString(string &out, const string &value) {
+    const char *hex = "0123456789abcdef";
+    out += '"';
+    
+    // Copy runs that need no escaping in one append
+    size_t run = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        char c = value[i];
+        if (c != '"' && c != '\\' && (unsigned char)c >= 0x20)
+            continue;
+        
+        out.append(value, run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else {
+            out += "\\u00";
+            out += hex[(c >> 4) & 0xF];
+            out += hex[c & 0xF];
+        }
+    }
+    out.append(value, run, string::npos);
+    out += '"';
+}
+
+// Records are formatted into one page buffer that is written with a single
+// call once it fills up, instead of many small stream insertions per record.
+// The buffer keeps its capacity between pages.
+class PageRenderer {
+private:
+    static const size_t PAGE_SIZE = 64 * 1024;
+    
+    string page;
+    ostream *out;
+    OutputFormat format;
+    int records;          // since the last EndListing
+    const char *listing;  // "feed", "inbox", "outbox" or "users"
+
+public:
+    PageRenderer(OutputFormat output_format = OutputFormat::TEXT, ostream &output = cout) :
+        out(&output), format(output_format), records(0), listing("") {
+        page.reserve(PAGE_SIZE);
+    }
+    
+    string& Page() { return page; }
+    
+    OutputFormat GetFormat() const { return format; }
+    void SetFormat(OutputFormat output_format) { format = output_format; }
+    bool IsJson() const { return format == OutputFormat::JSON_LINES; }
+    
+    void SetOutput(ostream &output) { out = &output; }
+    
+    // Names the listing that the following JSON records belong to
+    void BeginListing(const char *name) { listing = name; }
+    
+    // Opens a JSON object with its listing, so tooling can tell a feed
+    // from an inbox in a shared file
+    void BeginJsonRecord() {
+        page += "{\"listing\":\"";
+        page += listing;
+        page += '"';
+    }
+    
+    // Call after each record
+    void EndRecord() {
+        ++records;
+        if (page.size() >= PAGE_SIZE)
+            Flush();
+    }
+    
+    void Flush() {
+        if (!page.empty())
+            out->write(page.data(), page.size());
+        page.clear();
+    }
+    
+    // JSON lines go to their own stream, so the screen only gets a count
+    void EndListing() {
+        Flush();
+        out->flush();
+        if (IsJson())
+            cout << "JSON lines written: " << records << "\n";
+        records = 0;
+    }
+};
+
+// Records are serialized from a schema: one Field per column, in file
+// order, named by its JSON key. Fields added later get a higher
+// since_version and must come last (checked at compile time); lines or
+// records written before that version decode with the field reset to its
+// default.
+template <typename Record, typename T>
+struct Field {
+    T Record::*member;
+    string_view name;
+    int since_version;
+};
+
+template <typename Record, typename T>
+constexpr Field<Record, T> MakeField(T Record::*member, string_view name, int since_version = 1) {
+    return Field<Record, T>{member, name, since_version};
+}
+
+// Specialized next to each record type; provides VERSION and fields
+template <typename Record>
+struct Schema;
+
+void EncodeTextField(string &out, int value) {
+    AppendInt(out, value);
+}
+
+void EncodeTextField(string &out, const string &value) {
+    out += value;
+}
+
+// Surrounding spaces are allowed, as with the old istringstream parsing
+bool DecodeTextField(string_view text, int &value) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == string_view::npos)
+        return false;
+    text = text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    
+    auto result = from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == errc() && result.ptr == text.data() + text.size();
+}
+
+bool DecodeTextField(string_view text, string &value) {
+    value.assign(text.data(), text.size());
+    return true;
+}
+
+void WriteVarint(string &out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool ReadVarint(string_view data, size_t &pos, uint32_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && pos < data.size(); shift += 7) {
+        unsigned char byte = data[pos++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Ints are zigzag varints so -1 takes one byte; strings are length-prefixed
+void EncodeBinaryField(string &out, int value) {
+    WriteVarint(out, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+void EncodeBinaryField(string &out, const string &value) {
+    WriteVarint(out, value.size());
+    out += value;
+}
+
+bool DecodeBinaryField(string_view data, size_t &pos, int &value) {
+    uint32_t raw;
+    if (!ReadVarint(data, pos, raw))
+        return false;
+    value = (int)((raw >> 1) ^ (~(raw & 1) + 1));
+    return true;
+}
+
+void EncodeJsonField(string &out, int value) {
+    AppendInt(out, value);
+}
+
+void EncodeJsonField(string &out, const string &value) {
+    AppendJsonString(out, value);
+}
+
+bool DecodeBinaryField(string_view data, size_t &pos, string &value) {
+    uint32_t size;
+    if (!ReadVarint(data, pos, size) || data.size() - pos < size)
+        return false;
+    value.assign(data.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+// Fields must be listed oldest first, and none may be newer than VERSION
+template <typename RecordSchema>
+constexpr bool SchemaIsOrdered() {
+    int previous = 1;
+    bool ordered = true;
+    apply([&](const auto &... field) {
+        ((ordered = ordered && previous <= field.since_version &&
+                    field.since_version <= RecordSchema::VERSION,
+          previous = field.since_version), ...);
+    }, RecordSchema::fields);
+    return ordered;
+}
+
+// Text: fields joined by commas. Lines newer than version 1 start with
+// "v<version>," (a v1 line starts with its numeric id), so the version
+// never has to be guessed from the field count. Binary: varint schema
+// version, then the fields of that version.
+//
+// Fields newer than the decoded version are reset to their default, so a
+// reused record never keeps values from an earlier decode.
+template <typename Record>
+class RecordCodec {
+private:
+    using RecordSchema = Schema<Record>;
+    
+    static_assert(SchemaIsOrdered<RecordSchema>(),
+                  "Schema fields must have non-decreasing since_version, at most VERSION");
+    
+    static constexpr int FieldCount(int version) {
+        return apply([version](const auto &... field) {
+            return ((field.since_version <= version ? 1 : 0) + ... + 0);
+        }, RecordSchema::fields);
+    }
+    
+    static const Record& Defaults() {
+        static const Record defaults;
+        return defaults;
+    }
+
+public:
+    static void EncodeText(const Record &record, string &out) {
+        bool first = true;
+        if (RecordSchema::VERSION > 1) {
+            out += 'v';
+            AppendInt(out, RecordSchema::VERSION);
+            first = false;
+        }
+        apply([&](const auto &... field) {
+            ((out += first ? "" : ",", first = false, EncodeTextField(out, record.*field.member)), ...);
+        }, RecordSchema::fields);
+    }
+    
+    // Tolerates a trailing \r, e.g. from files saved with CRLF line endings
+    static bool DecodeText(string_view line, Record &record) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == '\n'))
+            line.remove_suffix(1);
+        
+        int version = 1;
+        if (!line.empty() && line[0] == 'v') {
+            size_t end = line.find(',');
+            if (end == string_view::npos || !DecodeTextField(line.substr(1, end - 1), version) ||
+                version < 2 || version > RecordSchema::VERSION)
+                return false;
+            line.remove_prefix(end + 1);
+        }
+        
+        if (count(line.begin(), line.end(), ',') + 1 != FieldCount(version))
+            return false;
+        
+        size_t start = 0;
+        bool ok = true;
+        auto decode = [&](const auto &field) {
+            if (field.since_version > version) {
+                record.*field.member = Defaults().*field.member;
+                return true;
+            }
+            size_t end = min(line.find(',', start), line.size());
+            bool decoded = DecodeTextField(line.substr(start, end - start), record.*field.member);
+            start = end + 1;
+            return decoded;
+        };
+        
+        apply([&](const auto &... field) { ((ok = ok && decode(field)), ...); }, RecordSchema::fields);
+        return ok;
+    }
+    
+    // Appends ,"name":value for each field keyed by its schema name;
+    // include(name) picks the fields. The caller opens and closes the object.
+    template <typename Include>
+    static void EncodeJsonFields(const Record &record, string &out, Include include) {
+        auto encode = [&](const auto &field) {
+            if (!include(field.name))
+                return;
+            out += ",\"";
+            out.append(field.name.data(), field.name.size());
+            out += "\":";
+            EncodeJsonField(out, record.*field.member);
+        };
+        
+        apply([&](const auto &... field) { (encode(field), ...); }, RecordSchema::fields);
+    }
+    
+    static void EncodeBinary(const Record &record, string &out) {
+        WriteVarint(out, RecordSchema::VERSION);
+        apply([&](const auto &... field) {
+            (EncodeBinaryField(out, record.*field.member), ...);
+        }, RecordSchema::fields);
+    }
+    
+    // Reads one record starting at pos and advances pos past it
+    static bool DecodeBinary(string_view data, size_t &pos, Record &record) {
+        uint32_t version;
+        if (!ReadVarint(data, pos, version) || version < 1 || version > (uint32_t)RecordSchema::VERSION)
+            return false;
+        
+        bool ok = true;
+        auto decode = [&](const auto &field) {
+            if ((uint32_t)field.since_version > version) {
+                record.*field.member = Defaults().*field.member;
+                return true;
+            }
+            return DecodeBinaryField(data, pos, record.*field.member);
+        };
+        
+        apply([&](const auto &... field) { ((ok = ok && decode(field)), ...); }, RecordSchema::fields);
+        return ok;
+    }
+};
+
 class Question {
 private:
     int question_id;
@@ -97,76 +858,103 @@ public:
         question_id(-1), parent_question_id(-1), 
         from_user_id(-1), to_user_id(-1), is_anonymous(1) {}
     
-    Question(const string &line) {
-        vector<string> parts = SplitString(line);
-        if (parts.size() != 7) {
-            cout << "ERROR: Invalid question format\n";
+    Question(const string &line);
+    
+    string ToString() const;
+    
+    void RenderQuestion(PageRenderer &renderer, bool is_to_me) const {
+        if (renderer.IsJson()) {
+            RenderJson(renderer);
             return;
         }
         
-        question_id = ToInt(parts[0]);
-        parent_question_id = ToInt(parts[1]);
-        from_user_id = ToInt(parts[2]);
-        to_user_id = ToInt(parts[3]);
-        is_anonymous = ToInt(parts[4]);
-        question_text = parts[5];
-        answer_text = parts[6];
-    }
-    
-    string ToString() const {
-        ostringstream oss;
-        oss << question_id << "," << parent_question_id << ","
-            << from_user_id << "," << to_user_id << ","
-            << is_anonymous << "," << question_text << ","
-            << answer_text;
-        return oss.str();
-    }
-    
-    void PrintQuestion(bool is_to_me) const {
-        string prefix = "";
+        string &out = renderer.Page();
+        const char *prefix = "";
         if (parent_question_id != -1)
             prefix = "\tThread: ";
         
-        cout << prefix << "Question ID (" << question_id << ")";
+        out += prefix;
+        out += "Question ID (";
+        AppendInt(out, question_id);
+        out += ")";
         
         if (is_to_me) {
-            if (!is_anonymous)
-                cout << " from user ID(" << from_user_id << ")";
-            cout << "\tQuestion: " << question_text << "\n";
+            if (!is_anonymous) {
+                out += " from user ID(";
+                AppendInt(out, from_user_id);
+                out += ")";
+            }
+            out += "\tQuestion: ";
+            out += question_text;
+            out += "\n";
             
-            if (!answer_text.empty())
-                cout << prefix << "\tAnswer: " << answer_text << "\n";
+            if (!answer_text.empty()) {
+                out += prefix;
+                out += "\tAnswer: ";
+                out += answer_text;
+                out += "\n";
+            }
         } else {
             if (!is_anonymous)
-                cout << " !Anonymous";
+                out += " !Anonymous";
             
-            cout << " to user ID(" << to_user_id << ")";
-            cout << "\tQuestion: " << question_text;
+            out += " to user ID(";
+            AppendInt(out, to_user_id);
+            out += ")\tQuestion: ";
+            out += question_text;
             
-            if (!answer_text.empty())
-                cout << "\tAnswer: " << answer_text << "\n";
-            else
-                cout << "\tNOT Answered YET\n";
+            if (!answer_text.empty()) {
+                out += "\tAnswer: ";
+                out += answer_text;
+                out += "\n";
+            } else {
+                out += "\tNOT Answered YET\n";
+            }
         }
         
-        cout << "\n";
+        out += "\n";
+        renderer.EndRecord();
     }
     
-    void PrintFeed() const {
-        if (parent_question_id != -1)
-            cout << "Thread Parent Question ID (" << parent_question_id << ") ";
+    void RenderFeed(PageRenderer &renderer) const {
+        if (renderer.IsJson()) {
+            RenderJson(renderer);
+            return;
+        }
         
-        cout << "Question ID (" << question_id << ")";
-        if (!is_anonymous)
-            cout << " from user ID(" << from_user_id << ")";
+        string &out = renderer.Page();
+        if (parent_question_id != -1) {
+            out += "Thread Parent Question ID (";
+            AppendInt(out, parent_question_id);
+            out += ") ";
+        }
         
-        cout << " to user ID(" << to_user_id << ")";
-        cout << "\tQuestion: " << question_text << "\n";
+        out += "Question ID (";
+        AppendInt(out, question_id);
+        out += ")";
+        if (!is_anonymous) {
+            out += " from user ID(";
+            AppendInt(out, from_user_id);
+            out += ")";
+        }
+        
+        out += " to user ID(";
+        AppendInt(out, to_user_id);
+        out += ")\tQuestion: ";
+        out += question_text;
+        out += "\n";
         
-        if (!answer_text.empty())
-            cout << "\tAnswer: " << answer_text << "\n";
+        if (!answer_text.empty()) {
+            out += "\tAnswer: ";
+            out += answer_text;
+            out += "\n";
+        }
+        renderer.EndRecord();
     }
     
+    // One JSON object per line; the sender is left out of anonymous questions
+    void RenderJson(PageRenderer &renderer) const;
+    
     int GetId() const { return question_id; }
     void SetId(int id) { question_id = id; }
     
@@ -189,8 +977,44 @@ public:
     void SetAnswer(const string& text) { answer_text = text; }
     
     bool IsAnswered() const { return !answer_text.empty(); }
+    
+    friend struct Schema<Question>;
+};
+
+template <>
+struct Schema<Question> {
+    static constexpr int VERSION = 1;
+    static constexpr auto fields = make_tuple(
+        MakeField(&Question::question_id, "question_id"),
+        MakeField(&Question::parent_question_id, "parent_question_id"),
+        MakeField(&Question::from_user_id, "from_user_id"),
+        MakeField(&Question::to_user_id, "to_user_id"),
+        MakeField(&Question::is_anonymous, "is_anonymous"),
+        MakeField(&Question::question_text, "question_text"),
+        MakeField(&Question::answer_text, "answer_text"));
 };
 
+Question::Question(const string &line) : Question() {
+    if (!RecordCodec<Question>::DecodeText(line, *this))
+        cout << "ERROR: Invalid question format\n";
+}
+
+string Question::ToString() const {
+    string line;
+    RecordCodec<Question>::EncodeText(*this, line);
+    return line;
+}
+
+void Question::RenderJson(PageRenderer &renderer) const {
+    string &out = renderer.Page();
+    renderer.BeginJsonRecord();
+    RecordCodec<Question>::EncodeJsonFields(*this, out, [this](string_view field) {
+        return !is_anonymous || field != "from_user_id";
+    });
+    out += "}\n";
+    renderer.EndRecord();
+}
+
 class User {
 private:
     int user_id;
@@ -206,33 +1030,18 @@ private:
 public:
     User() : user_id(-1), allow_anonymous(-1) {}
     
-    User(const string &line) {
-        vector<string> parts = SplitString(line);
-        if (parts.size() != 6) {
-            cout << "ERROR: Invalid user format\n";
-            return;
-        }
-        
-        user_id = ToInt(parts[0]);
-        username = parts[1];
-        password = parts[2];
-        name = parts[3];
-        email = parts[4];
-        allow_anonymous = ToInt(parts[5]);
-    }
+    User(const string &line);
     
-    string ToString() const {
-        ostringstream oss;
-        oss << user_id << "," << username << "," << password << ","
-            << name << "," << email << "," << allow_anonymous;
-        return oss.str();
-    }
+    string ToString() const;
     
     void Print() const {
         cout << "User " << user_id << ", " << username << ", " 
              << name << ", " << email << "\n";
     }
     
+    // Listing entry: only the public ID and name
+    void Render(PageRenderer &renderer) const;
+    
     void InputUserData(const string &user_name, int id) {
         username = user_name;
         user_id = id;
@@ -266,23 +1075,89 @@ public:
     
     const vector<int>& GetQuestionsFromMe() const { return questions_from_me; }
     const map<int, vector<int>>& GetQuestionsToMe() const { return questions_to_me; }
+    
+    friend struct Schema<User>;
 };
 
+template <>
+struct Schema<User> {
+    static constexpr int VERSION = 1;
+    static constexpr auto fields = make_tuple(
+        MakeField(&User::user_id, "user_id"),
+        MakeField(&User::username, "username"),
+        MakeField(&User::password, "password"),
+        MakeField(&User::name, "name"),
+        MakeField(&User::email, "email"),
+        MakeField(&User::allow_anonymous, "allow_anonymous"));
+};
+
+User::User(const string &line) : User() {
+    if (!RecordCodec<User>::DecodeText(line, *this))
+        cout << "ERROR: Invalid user format\n";
+}
+
+string User::ToString() const {
+    string line;
+    RecordCodec<User>::EncodeText(*this, line);
+    return line;
+}
+
+void User::Render(PageRenderer &renderer) const {
+    string &out = renderer.Page();
+    if (renderer.IsJson()) {
+        renderer.BeginJsonRecord();
+        RecordCodec<User>::EncodeJsonFields(*this, out, [](string_view field) {
+            return field == "user_id" || field == "name";
+        });
+        out += "}\n";
+    } else {
+        out += "ID: ";
+        AppendInt(out, user_id);
+        out += "\tName: ";
+        out += name;
+        out += "\n";
+    }
+    renderer.EndRecord();
+}
+
 class QuestionManager {
 private:
     map<int, vector<int>> thread_questions;  // parent_id -> [question_ids]
     map<int, Question> questions;            // question_id -> Question
     int next_id;
+    bool use_block_store;                    // questions.blk instead of questions.txt
+    bool store_damaged;                      // questions.blk failed to load; never save over it
+    mutable PageRenderer renderer;
+    mutable PageRenderer screen;             // always text on cout, for prompts
 
 public:
-    QuestionManager() : next_id(0) {}
+    QuestionManager() : next_id(0), use_block_store(false), store_damaged(false) {}
+    
+    void SetBlockStore(bool enabled) { use_block_store = enabled; }
+    void SetOutput(OutputFormat format, ostream &output) {
+        renderer.SetFormat(format);
+        renderer.SetOutput(output);
+    }
     
     void LoadDatabase() {
         next_id = 0;
         thread_questions.clear();
         questions.clear();
         
-        vector<string> lines = ReadFileLines("questions.txt");
+        // Without a block store yet, fall back to the text file so it gets migrated on the next save
+        vector<string> lines;
+        store_damaged = false;
+        if (use_block_store && filesystem::exists("questions.blk")) {
+            BlockStore store;
+            if (!store.Open("questions.blk") || !store.ReadAll(lines)) {
+                cout << "ERROR: questions.blk is damaged. Changes won't be saved until it is repaired\n";
+                store_damaged = true;
+                return;
+            }
+        } else {
+            lines = ReadFileLines("questions.txt");
+        }
+        
         for (const auto &line : lines) {
             Question question(line);
             next_id = max(next_id, question.GetId());
@@ -297,12 +1172,20 @@ public:
         }
     }
     
-    void SaveDatabase() {
+    bool SaveDatabase() {
+        if (store_damaged) {
+            cout << "\nERROR: questions.blk is damaged. Nothing saved\n";
+            return false;
+        }
+        
         vector<string> lines;
         for (const auto &pair : questions) {
             lines.push_back(pair.second.ToString());
         }
-        WriteFileLines("questions.txt", lines, false);
+        
+        if (use_block_store)
+            return BlockStore::Write("questions.blk", lines);
+        return WriteFileLines("questions.txt", lines, false);
     }
     
     map<int, vector<int>> GetQuestionsToUser(int user_id) const {
@@ -333,36 +1216,46 @@ public:
         return result;
     }
     
+    // In JSON lines mode only the records are printed, one per line
     void PrintUserQuestions(const User &user, bool to_me) const {
-        cout << "\n";
+        renderer.BeginListing(to_me ? "inbox" : "outbox");
+        bool text = !renderer.IsJson();
+        if (text)
+            renderer.Page() += "\n";
         
         if (to_me) {
             const auto &q_to_me = user.GetQuestionsToMe();
             if (q_to_me.empty()) {
-                cout << "No questions to you.\n";
+                if (text)
+                    renderer.Page() += "No questions to you.\n";
+                renderer.EndListing();
                 return;
             }
             
             for (const auto &thread : q_to_me) {
                 for (int q_id : thread.second) {
                     const Question &q = questions.at(q_id);
-                    q.PrintQuestion(true);
+                    q.RenderQuestion(renderer, true);
                 }
             }
         } else {  // from me
             const auto &q_from_me = user.GetQuestionsFromMe();
             if (q_from_me.empty()) {
-                cout << "You haven't asked any questions.\n";
+                if (text)
+                    renderer.Page() += "You haven't asked any questions.\n";
+                renderer.EndListing();
                 return;
             }
             
             for (int q_id : q_from_me) {
                 const Question &q = questions.at(q_id);
-                q.PrintQuestion(false);
+                q.RenderQuestion(renderer, false);
             }
         }
         
-        cout << "\n";
+        if (text)
+            renderer.Page() += "\n";
+        renderer.EndListing();
     }
     
     int ReadQuestionIdForUser(int user_id, bool for_answering = false) const {
@@ -407,8 +1300,9 @@ public:
         if (question_id == -1)
             return;
         
-        Question &question = questions.at(question_id);
-        question.PrintQuestion(true);
+        const Question &question = questions.at(question_id);
+        question.RenderQuestion(screen, true);
+        screen.Flush();
         
         if (question.IsAnswered())
             cout << "\nWarning: Already answered. Answer will be updated\n";
@@ -417,9 +1311,57 @@ public:
         string answer;
         cin.ignore();  // Clear the input buffer
         getline(cin, answer);
-        question.SetAnswer(answer);
         
-        SaveDatabase();
+        AnswerQuestions(user_id, {{question_id, answer}});
+    }
+    
+    void AnswerManyQuestions(int user_id) {
+        vector<pair<int, string>> answers;
+        set<int> seen;
+        
+        while (true) {
+            int question_id = ReadQuestionIdForUser(user_id, true);
+            if (question_id == -1)
+                break;
+            
+            if (!seen.insert(question_id).second) {
+                cout << "\nERROR: Question already answered in this batch. Try again\n\n";
+                continue;
+            }
+            
+            questions.at(question_id).RenderQuestion(screen, true);
+            screen.Flush();
+            cout << "Enter answer: ";
+            string answer;
+            cin.ignore();  // Clear the input buffer
+            getline(cin, answer);
+            answers.push_back({question_id, answer});
+        }
+        
+        if (!answers.empty())
+            AnswerQuestions(user_id, answers);
+    }
+    
+    // Applies all answers and saves once, or changes nothing if any is invalid.
+    // Returns false if the batch is rejected or the save fails.
+    bool AnswerQuestions(int user_id, const vector<pair<int, string>> &answers) {
+        set<int> seen;
+        for (const auto &answer : answers) {
+            auto it = questions.find(answer.first);
+            if (it == questions.end() || it->second.GetToUserId() != user_id) {
+                cout << "\nERROR: Question " << answer.first << " can't be answered by you. Nothing saved\n";
+                return false;
+            }
+            if (!seen.insert(answer.first).second) {
+                cout << "\nERROR: Question " << answer.first << " answered twice. Nothing saved\n";
+                return false;
+            }
+        }
+        
+        for (const auto &answer : answers)
+            questions.at(answer.first).SetAnswer(answer.second);
+        
+        return SaveDatabase();
     }
     
     void DeleteQuestion(int user_id) {
@@ -427,85 +1369,159 @@ public:
         if (question_id == -1)
             return;
         
-        vector<int> to_remove;
+        DeleteQuestions(user_id, {question_id});
+    }
+    
+    void DeleteManyQuestions(int user_id) {
+        vector<int> question_ids;
+        set<int> seen;
         
-        // Check if it's a thread parent
-        if (thread_questions.find(question_id) != thread_questions.end()) {
-            to_remove = thread_questions[question_id];
-            thread_questions.erase(question_id);
-        } else {
-            to_remove.push_back(question_id);
+        while (true) {
+            int question_id = ReadQuestionIdForUser(user_id, true);
+            if (question_id == -1)
+                break;
             
-            // Find and remove from its thread
-            for (auto &thread : thread_questions) {
-                auto &questions_list = thread.second;
-                auto it = find(questions_list.begin(), questions_list.end(), question_id);
-                if (it != questions_list.end()) {
-                    questions_list.erase(it);
-                    break;
-                }
+            if (!seen.insert(question_id).second) {
+                cout << "\nERROR: Question already in this batch. Try again\n\n";
+                continue;
+            }
+            question_ids.push_back(question_id);
+        }
+        
+        if (!question_ids.empty())
+            DeleteQuestions(user_id, question_ids);
+    }
+    
+    // Deleting a thread parent removes its whole thread. Saves once, or
+    // changes nothing if any question is invalid. Returns false if the batch
+    // is rejected or the save fails.
+    bool DeleteQuestions(int user_id, const vector<int> &question_ids) {
+        set<int> seen, to_remove;
+        
+        for (int question_id : question_ids) {
+            auto it = questions.find(question_id);
+            if (it == questions.end() || it->second.GetToUserId() != user_id) {
+                cout << "\nERROR: Question " << question_id << " can't be deleted by you. Nothing deleted\n";
+                return false;
             }
+            if (!seen.insert(question_id).second) {
+                cout << "\nERROR: Question " << question_id << " listed twice. Nothing deleted\n";
+                return false;
+            }
+            
+            auto thread = thread_questions.find(question_id);
+            if (thread != thread_questions.end())
+                to_remove.insert(thread->second.begin(), thread->second.end());
+            else
+                to_remove.insert(question_id);
         }
         
-        // Remove all questions
         for (int id : to_remove) {
             questions.erase(id);
+            thread_questions.erase(id);
         }
         
-        SaveDatabase();
+        for (auto &thread : thread_questions) {
+            auto &questions_list = thread.second;
+            questions_list.erase(remove_if(questions_list.begin(), questions_list.end(),
+                                           [&](int id) { return to_remove.count(id) > 0; }),
+                                 questions_list.end());
+        }
+        
+        return SaveDatabase();
     }
     
     void AskQuestion(const User &from_user, int to_user_id, bool allows_anonymous) {
-        Question question;
+        AskQuestionToMany(from_user, {{to_user_id, allows_anonymous}});
+    }
+    
+    // recipients: user_id -> allows anonymous questions
+    void AskQuestionToMany(const User &from_user, const vector<pair<int, bool>> &recipients) {
+        bool any_allows_anonymous = false;
+        for (const auto &recipient : recipients)
+            any_allows_anonymous = any_allows_anonymous || recipient.second;
         
-        if (!allows_anonymous) {
-            cout << "Note: Anonymous questions are not allowed for this user\n";
-            question.SetAnonymous(0);
+        int anon = 0;
+        if (!any_allows_anonymous) {
+            cout << "Note: Anonymous questions are not allowed for "
+                 << (recipients.size() == 1 ? "this user\n" : "these users\n");
         } else {
+            if (recipients.size() > 1)
+                cout << "Note: Users who don't allow anonymous questions will see your ID\n";
             cout << "Ask anonymously? (0 or 1): ";
-            int anon;
             cin >> anon;
-            question.SetAnonymous(anon);
         }
         
         int parent_id = ReadThreadQuestionId();
-        question.SetParentId(parent_id);
         
         cout << "Enter question text: ";
         string text;
         cin.ignore();  // Clear the input buffer
         getline(cin, text);
-        question.SetQuestion(text);
         
-        question.SetFromUserId(from_user.GetId());
-        question.SetToUserId(to_user_id);
-        question.SetId(++next_id);
+        AskQuestions(from_user.GetId(), recipients, parent_id, text, anon);
+    }
+    
+    // Sends one question to every recipient and saves once, or changes
+    // nothing if the batch is invalid. Returns false if the batch is
+    // rejected or the save fails.
+    bool AskQuestions(int from_user_id, const vector<pair<int, bool>> &recipients,
+                      int parent_id, const string &text, bool anonymous) {
+        if (recipients.empty()) {
+            cout << "\nERROR: No users to ask. Nothing saved\n";
+            return false;
+        }
         
-        questions[question.GetId()] = question;
+        if (parent_id != -1 && thread_questions.find(parent_id) == thread_questions.end()) {
+            cout << "\nERROR: No thread question with ID " << parent_id << ". Nothing saved\n";
+            return false;
+        }
         
-        if (parent_id == -1) {
-            thread_questions[question.GetId()].push_back(question.GetId());
-        } else {
-            thread_questions[parent_id].push_back(question.GetId());
+        set<int> seen;
+        for (const auto &recipient : recipients) {
+            if (!seen.insert(recipient.first).second) {
+                cout << "\nERROR: User " << recipient.first << " listed twice. Nothing saved\n";
+                return false;
+            }
         }
         
-        SaveDatabase();
+        for (const auto &recipient : recipients) {
+            Question question;
+            question.SetAnonymous(anonymous && recipient.second);
+            question.SetParentId(parent_id);
+            question.SetQuestion(text);
+            question.SetFromUserId(from_user_id);
+            question.SetToUserId(recipient.first);
+            question.SetId(++next_id);
+            
+            questions[question.GetId()] = question;
+            
+            if (parent_id == -1) {
+                thread_questions[question.GetId()].push_back(question.GetId());
+            } else {
+                thread_questions[parent_id].push_back(question.GetId());
+            }
+        }
+        
+        return SaveDatabase();
     }
     
     void ListFeed() const {
+        renderer.BeginListing("feed");
         bool found = false;
         
         for (const auto &pair : questions) {
             const Question &q = pair.second;
             if (q.IsAnswered()) {
-                q.PrintFeed();
+                q.RenderFeed(renderer);
                 found = true;
             }
         }
         
-        if (!found) {
-            cout << "No answered questions in the feed.\n";
+        if (!found && !renderer.IsJson()) {
+            renderer.Page() += "No answered questions in the feed.\n";
         }
+        renderer.EndListing();
     }
 };
 
@@ -514,10 +1530,16 @@ private:
     map<string, User> users;
     User current_user;
     int next_id;
+    mutable PageRenderer renderer;
     
 public:
     UserManager() : next_id(0) {}
     
+    void SetOutput(OutputFormat format, ostream &output) {
+        renderer.SetFormat(format);
+        renderer.SetOutput(output);
+    }
+    
     void LoadDatabase() {
         next_id = 0;
         users.clear();
@@ -578,11 +1600,14 @@ public:
     }
     
     void ListUsers() const {
-        cout << "\nSystem Users:\n";
+        renderer.BeginListing("users");
+        if (!renderer.IsJson())
+            renderer.Page() += "\nSystem Users:\n";
+        
         for (const auto &pair : users) {
-            const User &user = pair.second;
-            cout << "ID: " << user.GetId() << "\tName: " << user.GetName() << "\n";
+            pair.second.Render(renderer);
         }
+        renderer.EndListing();
     }
     
     pair<int, bool> ReadUserId() const {
@@ -603,6 +1628,27 @@ public:
         return ReadUserId();
     }
     
+    // Returns user_id -> allows anonymous for each entered user
+    vector<pair<int, bool>> ReadUserIds() const {
+        vector<pair<int, bool>> recipients;
+        set<int> seen;
+        cout << "Enter User IDs, then -1 to finish:\n";
+        
+        while (true) {
+            auto recipient = ReadUserId();
+            if (recipient.first == -1)
+                break;
+            
+            if (!seen.insert(recipient.first).second) {
+                cout << "User already in this batch. Try again.\n";
+                continue;
+            }
+            recipients.push_back(recipient);
+        }
+        
+        return recipients;
+    }
+    
     void SaveUser(const User &user) {
         users[user.GetUsername()] = user;
         vector<string> lines = {user.ToString()};
@@ -622,6 +1668,7 @@ class AskSystem {
 private:
     UserManager user_manager;
     QuestionManager question_manager;
+    ofstream json_output;
     
     void LoadData(bool refresh_user_questions = false) {
         user_manager.LoadDatabase();
@@ -648,6 +1695,9 @@ private:
             "Ask Question",
             "List System Users",
             "View Feed",
+            "Ask Question To Many Users",
+            "Answer Many Questions",
+            "Delete Many Questions",
             "Logout"
         };
         
@@ -690,7 +1740,25 @@ private:
                     question_manager.ListFeed();
                     break;
                     
-                case 8:  // Logout
+                case 8: {  // Ask Question To Many Users
+                    auto recipients = user_manager.ReadUserIds();
+                    if (!recipients.empty()) {
+                        question_manager.AskQuestionToMany(user_manager.GetCurrentUser(),
+                                                           recipients);
+                    }
+                    break;
+                }
+                
+                case 9:  // Answer Many Questions
+                    question_manager.AnswerManyQuestions(user_manager.GetCurrentUser().GetId());
+                    break;
+                    
+                case 10:  // Delete Many Questions
+                    question_manager.DeleteManyQuestions(user_manager.GetCurrentUser().GetId());
+                    RefreshUserQuestions();
+                    break;
+                    
+                case 11:  // Logout
                     return;
             }
         }
@@ -714,6 +1782,21 @@ private:
     }
     
 public:
+    void SetBlockStore(bool enabled) { question_manager.SetBlockStore(enabled); }
+    
+    // Listings are written as JSON lines to path instead of as text to the screen
+    bool SetJsonOutput(const string &path) {
+        json_output.open(path.c_str(), ios::app);
+        if (json_output.fail()) {
+            cout << "\nERROR: Can't open the file: " << path << "\n";
+            return false;
+        }
+        
+        user_manager.SetOutput(OutputFormat::JSON_LINES, json_output);
+        question_manager.SetOutput(OutputFormat::JSON_LINES, json_output);
+        return true;
+    }
+    
     void Run() {
         while (true) {
             AccessSystem();
@@ -722,8 +1805,232 @@ public:
     }
 };
 
-int main() {
+vector<Question> GenerateQuestions(int count) {
+    vector<string> subjects = {"your favorite movie", "the best book you read", "your dream job",
+                               "your hometown", "your morning routine", "the last trip you took"};
+    vector<string> openers = {"What is", "Tell me about", "How do you feel about", "Why do you like"};
+    
+    vector<Question> result;
+    for (int id = 1; id <= count; ++id) {
+        Question question;
+        question.SetId(id);
+        question.SetParentId(id % 5 == 0 ? id - 1 : -1);
+        question.SetFromUserId(id % 97 + 1);
+        question.SetToUserId(id % 89 + 1);
+        question.SetAnonymous(id % 3 == 0);
+        question.SetQuestion(openers[id % openers.size()] + " " + subjects[id % subjects.size()] + "?");
+        if (id % 2 == 0)
+            question.SetAnswer("I would say " + subjects[(id / 2) % subjects.size()] + ", honestly");
+        result.push_back(question);
+    }
+    return result;
+}
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Compares the plain text file against the block store on generated questions
+void BenchmarkStorage(int record_count = 100000) {
+    vector<string> lines;
+    for (const auto &question : GenerateQuestions(record_count))
+        lines.push_back(question.ToString());
+    
+    const string text_path = "bench_questions.txt", block_path = "bench_questions.blk";
+    ofstream(text_path.c_str(), ios::trunc).close();
+    WriteFileLines(text_path, lines, false);
+    BlockStore::Write(block_path, lines);
+    
+    auto file_size = [](const string &path) {
+        ifstream file(path.c_str(), ios::binary | ios::ate);
+        return (double)file.tellg();
+    };
+    double text_size = file_size(text_path), block_size = file_size(block_path);
+    
+    const int rounds = 5;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        ReadFileLines(text_path);
+    double text_time = SecondsSince(start) / rounds;
+    
+    start = chrono::steady_clock::now();
+    vector<string> loaded;
+    for (int i = 0; i < rounds; ++i) {
+        BlockStore store;
+        store.Open(block_path);
+        store.ReadAll(loaded);
+    }
+    double block_time = SecondsSince(start) / rounds;
+    
+    const int lookups = 10000;
+    BlockStore store;
+    store.Open(block_path);
+    string line;
+    int found = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i)
+        found += store.ReadRecord((i * 7919) % record_count + 1, line);
+    double lookup_time = SecondsSince(start);
+    
+    cout << "Records:            " << record_count << " (" << loaded.size() << " loaded from block store)\n";
+    cout << "Text file:          " << text_size / 1024 << " KB\n";
+    cout << "Block store:        " << block_size / 1024 << " KB\n";
+    cout << "Compression ratio:  " << text_size / block_size << "x\n";
+    cout << "Text load:          " << text_size / text_time / 1e6 << " MB/s\n";
+    cout << "Block store load:   " << text_size / block_time / 1e6 << " MB/s\n";
+    cout << "Single record read: " << lookup_time / lookups * 1e6 << " us (" << found << " found)\n";
+    
+    remove(text_path.c_str());
+    remove(block_path.c_str());
+}
+
+// Prints the feed of generated questions with per-field stream insertions
+// (the old PrintFeed) and with the page renderer. Timings go to cerr, so
+// run with stdout redirected, e.g. to /dev/null.
+void BenchmarkRendering(int record_count = 200000) {
+    vector<Question> questions = GenerateQuestions(record_count);
+    
+    auto start = chrono::steady_clock::now();
+    for (const auto &q : questions) {
+        if (q.GetParentId() != -1)
+            cout << "Thread Parent Question ID (" << q.GetParentId() << ") ";
+        cout << "Question ID (" << q.GetId() << ")";
+        if (!q.IsAnonymous())
+            cout << " from user ID(" << q.GetFromUserId() << ")";
+        cout << " to user ID(" << q.GetToUserId() << ")";
+        cout << "\tQuestion: " << q.GetQuestion() << "\n";
+        if (q.IsAnswered())
+            cout << "\tAnswer: " << q.GetAnswer() << "\n";
+    }
+    cout.flush();
+    double stream_time = SecondsSince(start);
+    
+    PageRenderer renderer;
+    start = chrono::steady_clock::now();
+    for (const auto &q : questions)
+        q.RenderFeed(renderer);
+    renderer.Flush();
+    cout.flush();
+    double text_time = SecondsSince(start);
+    
+    renderer.SetFormat(OutputFormat::JSON_LINES);
+    renderer.BeginListing("feed");
+    start = chrono::steady_clock::now();
+    for (const auto &q : questions)
+        q.RenderFeed(renderer);
+    renderer.Flush();
+    cout.flush();
+    double json_time = SecondsSince(start);
+    
+    cerr << "Records:                " << record_count << "\n";
+    cerr << "Stream insertions:      " << stream_time * 1000 << " ms\n";
+    cerr << "Page renderer (text):   " << text_time * 1000 << " ms\n";
+    cerr << "Page renderer (JSONL):  " << json_time * 1000 << " ms\n";
+}
+
+// Compares the old ostringstream / SplitString question serialization with
+// the schema generated text and binary codecs
+void BenchmarkSerialization(int record_count = 200000) {
+    vector<Question> questions = GenerateQuestions(record_count);
+    vector<string> lines(questions.size());
+    size_t checksum = 0;
+    
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < questions.size(); ++i) {
+        const Question &q = questions[i];
+        ostringstream oss;
+        oss << q.GetId() << "," << q.GetParentId() << ","
+            << q.GetFromUserId() << "," << q.GetToUserId() << ","
+            << q.IsAnonymous() << "," << q.GetQuestion() << ","
+            << q.GetAnswer();
+        lines[i] = oss.str();
+    }
+    double stream_encode = SecondsSince(start);
+    
+    start = chrono::steady_clock::now();
+    for (const auto &line : lines) {
+        vector<string> parts = SplitString(line);
+        Question q;
+        q.SetId(ToInt(parts[0]));
+        q.SetParentId(ToInt(parts[1]));
+        q.SetFromUserId(ToInt(parts[2]));
+        q.SetToUserId(ToInt(parts[3]));
+        q.SetAnonymous(ToInt(parts[4]));
+        q.SetQuestion(parts[5]);
+        q.SetAnswer(parts[6]);
+        checksum += q.GetId();
+    }
+    double stream_decode = SecondsSince(start);
+    
+    string text;
+    start = chrono::steady_clock::now();
+    for (const auto &q : questions) {
+        RecordCodec<Question>::EncodeText(q, text);
+        text += '\n';
+    }
+    double text_encode = SecondsSince(start);
+    
+    Question decoded;
+    start = chrono::steady_clock::now();
+    for (size_t pos = 0, end; (end = text.find('\n', pos)) != string::npos; pos = end + 1) {
+        RecordCodec<Question>::DecodeText(string_view(text).substr(pos, end - pos), decoded);
+        checksum += decoded.GetId();
+    }
+    double text_decode = SecondsSince(start);
+    
+    string binary;
+    start = chrono::steady_clock::now();
+    for (const auto &q : questions)
+        RecordCodec<Question>::EncodeBinary(q, binary);
+    double binary_encode = SecondsSince(start);
+    
+    start = chrono::steady_clock::now();
+    for (size_t pos = 0; pos < binary.size() && RecordCodec<Question>::DecodeBinary(binary, pos, decoded);)
+        checksum += decoded.GetId();
+    double binary_decode = SecondsSince(start);
+    
+    cout << "Records: " << record_count << " (checksum " << checksum << ")\n";
+    auto report = [](const char *name, double encode, double decode, size_t bytes) {
+        cout << name << "encode " << encode * 1000 << " ms, decode " << decode * 1000
+             << " ms, " << bytes / 1024 << " KB\n";
+    };
+    report("ostringstream/SplitString: ", stream_encode, stream_decode, text.size());
+    report("Schema text:               ", text_encode, text_decode, text.size());
+    report("Schema binary:             ", binary_encode, binary_decode, binary.size());
+}
+
+// Options:
+//   --block-store    keep questions in the compressed questions.blk
+//   --json FILE      append questions, feeds and user lists to FILE as JSON lines
+//   --bench-storage  compare text and block store size and load speed
+//   --bench-render   compare stream printing with the page renderer
+//   --bench-serialize compare the old and schema generated serializers
+int main(int argc, char *argv[]) {
     AskSystem system;
+    
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--block-store") {
+            system.SetBlockStore(true);
+        } else if (arg == "--json") {
+            if (i + 1 == argc) {
+                cout << "ERROR: --json needs a file name\n";
+                return 1;
+            }
+            if (!system.SetJsonOutput(argv[++i]))
+                return 1;
+        } else if (arg == "--bench-storage") {
+            BenchmarkStorage();
+            return 0;
+        } else if (arg == "--bench-render") {
+            BenchmarkRendering();
+            return 0;
+        } else if (arg == "--bench-serialize") {
+            BenchmarkSerialization();
+            return 0;
+        }
+    }
+    
     system.Run();
     return 0;
 }
\ No newline at end of file